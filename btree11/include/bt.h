@@ -154,6 +154,17 @@ void get_key_data(void *targetkey, Datatype *targetdata,
                   NodeType ndtype);
 
 
+/*
+ * make_separator: write to *sep the shortest key k with left < k <= right,
+ * i.e. the smallest entry that may go into a parent index page to tell
+ * the page ending with `left' from the page starting with `right'.  Only
+ * string keys can be shortened; otherwise (and when left == right) the
+ * separator is `right' itself.
+ */
+
+void make_separator(void *sep, const void *left, const void *right,
+                    AttrType key_type);
+
 int get_key_length(const void *key, const AttrType key_type);
 int get_key_data_length(const void *key, const AttrType key_type,
                         const NodeType ndtype);
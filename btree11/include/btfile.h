@@ -26,18 +26,62 @@
    b-tree during its operations.  You must set BTreeFile::Trace to the
    ostream of your choice before creating your BTreeFile. */
 
+#include <stdint.h>
+#include <pthread.h>
+
 #include "btindex_page.h"
 #include "btleaf_page.h"
 #include "index.h"
 #include "btree_file_scan.h"
+#include "btree_parallel_scan.h"
 #include "bt.h"
 
+class PageLatch;
+
 #define NAIVE_DELETE 0
 #define FULL_DELETE  1
 
+// node layouts; PACKED_INT_LAYOUT only applies to attrInteger keys and
+// keeps each page's entries back to back in key order so that they can
+// be searched with vector compares (see SortedPage::packed_rank).
+// PREFIX_STRING_LAYOUT only applies to attrString keys and front-codes
+// the leaf pages (see BTLeafPage::set_prefixed).
+#define SLOTTED_LAYOUT       0
+#define PACKED_INT_LAYOUT    1
+#define PREFIX_STRING_LAYOUT 2
+
+/*
+ * LookupResults holds what BTreeFile::lookupMany found: the data RIDs
+ * of all entries matching each probe, grouped by probe.
+ */
+
+class LookupResults {
+	public:
+		LookupResults();
+		~LookupResults();
+
+		// matches of probe i: count(i) RIDs starting at matches(i)
+		int  count(int i)   { return start[i+1] - start[i]; }
+		RID *matches(int i) { return rids + start[i]; }
+
+	private:
+		friend class BTreeFile;
+
+		RID *rids;
+		int *probes;      // probe of each rid while collecting
+		int *start;       // [nprobes+1]; matches of i are rids[start[i]..]
+		int  nrids;
+		int  maxrids;
+
+		void reset(int nprobes);
+		void add(int probe, RID rid);
+		void finish(int nprobes);   // group rids[] by probe
+};
+
 class BTreeFile: public IndexFile {
 	public:
 		friend class BTreeFileScan;
+		friend class BTreeParallelScan;
 
 		/*
 		 * Structure of a B+ tree index header page.  There is quite a bit
@@ -54,6 +98,49 @@ class BTreeFile: public IndexFile {
 			+ 4 * sizeof(short)
 			+ 3 * sizeof(PageId);
 
+		// upper bound on the number of index levels (used to size the
+		// right spine while bulk loading)
+		const static int MAX_TREE_HEIGHT = 32;
+
+		// record and slot space of an empty page (see nodeBytes)
+		static int maxNodeBytes()
+		{ return MINIBASE_PAGESIZE - DPFIXED + sizeof(slot_t); }
+
+		// a split looks this many entries either side of the middle for
+		// the split point with the shortest separator
+		const static int SPLIT_WINDOW = 4;
+
+		// insertBatch splits a full leaf at most this many times (fewer if
+		// a new root could not take the separators) per pass down the tree
+		const static int BATCH_SPLITS = 8;
+
+		// partition reads at most this many levels below the root, and
+		// stops going down once it has this many separators per range
+		const static int PARTITION_LEVELS = 2;
+		const static int PARTITION_SPREAD = 8;
+
+		// New pages come out of extents: runs of pages reserved in one
+		// go, the leaves' apart from the index pages', and handed out in
+		// page order, so that leaves split off one after another (as
+		// when keys come in ascending order, or bulkLoad writes them)
+		// lie one after another in the file.  Pages from next to end
+		// are still to be handed out.
+		struct Extent {
+			PageId next;
+			PageId end;
+		};
+
+		const static int LEAF_EXTENT = 64;
+		const static int INDEX_EXTENT = 8;
+
+		// Under FULL_DELETE a node other than the root is underfull once
+		// less than MERGE_FILL percent of it is in use, and is then
+		// merged with or fed entries by its sibling (see rebalance).
+		const static int MERGE_FILL = 25;
+
+		// reorganize moves nodes to runs of this many pages at a time
+		const static int REORG_EXTENT = 256;
+
 		struct BTreeHeaderPage {
 			unsigned long magic0; // magic number for sanity checking
 
@@ -61,6 +148,17 @@ class BTreeFile: public IndexFile {
 			AttrType key_type;   // type of keys in tree
 			int keysize;         // max key length (specified at index creation)
 			int delete_fashion;  // naive delete algorithm or full delete algorithm
+			int node_layout;     // SLOTTED_LAYOUT, PACKED_INT_LAYOUT, ...
+			Extent leaf_extent;  // pages for new leaves (see newNode)
+			Extent index_extent; // and for new index pages
+			PageId free_nodes;   // nodes merged away, for reuse (see freeNode)
+
+			// where a reorganize pass has got to (see reorganize)
+			int reorg_level;     // level it is on, leaves being 0; -1 if none
+			int reorg_has_key;   // else it starts the level at its left end
+			Keytype reorg_key;   // the next child it looks at falls here
+			PageId reorg_last;   // the last node it placed
+			Extent reorg_extent; // the pages it moves nodes to
 
 			/*
 			 * Note that we need not store the "file name" associated with this
@@ -100,6 +198,13 @@ class BTreeFile: public IndexFile {
 			CANT_ALLOCATE_NEW_PAGE, // bm::newPage failed
 			CANT_SPLIT_LEAF_PAGE,   // could not split leaf page
 			CANT_SPLIT_INDEX_PAGE,  // could not split index page
+			BULKLOAD_NOT_EMPTY,     // bulkLoad called on a non-empty index
+			BULKLOAD_UNSORTED,      // bulkLoad input not in ascending key order
+			BAD_FILL_FACTOR,        // fill factor outside of 1..100
+			TREE_TOO_HIGH,          // tree would exceed MAX_TREE_HEIGHT levels
+			BAD_SORT_PAGES,         // external sort given fewer than 3 pages
+			CANT_START_WORKER,      // parallel scan could not start a thread
+			PARALLEL_SCAN_READ_ONLY,// delete_current on a parallel scan
 
 			NR_ERRORS               // and this is the number of them
 		};
@@ -111,7 +216,8 @@ class BTreeFile: public IndexFile {
 
 		// if index exists, open it; else create it.
 		BTreeFile(Status& status, const char *filename, const AttrType keytype,
-				const int keysize, int delete_fashion = NAIVE_DELETE);   //delete_fashion = FULL_DELETE	
+				const int keysize, int delete_fashion = NAIVE_DELETE,   //delete_fashion = FULL_DELETE	
+				int node_layout = SLOTTED_LAYOUT);
 
 		// closes index
 		~BTreeFile();
@@ -141,6 +247,67 @@ class BTreeFile: public IndexFile {
 		IndexFileScan *new_scan(const void *lo_key = NULL,
 				const void *hi_key = NULL);
 
+		// create a scan of the same range run by up to nworkers threads,
+		// each scanning a key range of its own (see BTreeParallelScan).
+		// With ordered set the entries come back in key order, else in
+		// batches from whichever thread is ready.
+		BTreeParallelScan *new_parallel_scan(const void *lo_key,
+				const void *hi_key, int nworkers, bool ordered = false);
+
+		// insert n <key, rid> pairs (keys[i] with rids[i]) in one go: the
+		// batch is sorted and each leaf it goes to is found and latched
+		// once for all the entries that fit on it, rather than once per
+		// entry.
+		Status insertBatch(const void *keys[], const RID rids[], int n);
+
+		// point lookups for n keys at once: results.matches(i) gets the
+		// RIDs of all entries with key keys[i], duplicates included.  The
+		// probes are sorted so that each page on the way down is pinned
+		// once for all probes passing through it.
+		Status lookupMany(const void *keys[], int n, LookupResults &results);
+
+		// build an empty index bottom-up from <key, rid> pairs delivered in
+		// ascending key order.  Leaf pages are filled sequentially up to
+		// fill_factor percent of their space and chained as they go; the
+		// index levels are built along the right spine and the header is
+		// updated once at the end.
+		Status bulkLoad(SortedKeySource *source, int fill_factor = 100);
+
+		// build an empty index from <key, rid> pairs in any order: they are
+		// sorted externally (see BTreeSort) using at most sortpages pages
+		// of memory, and the final merge feeds bulkLoad directly.  With
+		// nworkers > 1 the sort and the leaves are done by that many
+		// threads, each for a key range of its own (see BTreeParallelSort),
+		// and the index levels are built over their leaves at the end.
+		Status build(KeySource *source, int sortpages, int fill_factor = 100,
+				int nworkers = 1);
+
+		// reorganize the index while it is in use, about maxPages nodes at
+		// a time; done is set once a whole pass is over.  A pass goes up
+		// the tree a level at a time, each in key order: adjacent
+		// siblings that fit in fill_factor percent of a page together
+		// are merged, a node is then filled up to that from the next
+		// one, and every node is moved to the page after the one
+		// placed before it, so that each level ends up in key order on
+		// consecutive pages, the leaves first.  Where the pass has got to
+		// is kept in the header, so the next call goes on from there.
+		// At the end of a pass the nodes it left behind, and any others
+		// merged away since, go back to the DB.
+		Status reorganize(int maxPages, bool &done, int fill_factor = 90);
+
+		// the number of leaves, counted along the leaf level from the
+		// leftmost one.
+		Status countLeaves(int &n);
+
+		// the separators on the index pages: how many, how many bytes
+		// their keys take up together, and the longest one's length.
+		Status countSeparators(int &n, int &bytes, int &longest);
+
+		// take back an insert or a delete of an aborted transaction, as
+		// logged for it (see logUndo); RecoveryMgr hands body back here.
+		// An entry that is already as it was before is left alone.
+		static Status undo(const char *body, int length);
+
 		int keysize();
 
 
@@ -162,35 +329,281 @@ class BTreeFile: public IndexFile {
 		// Change the root of the tree to the specified page.
 		Status updateHeader (PageId newRoot);
 
+		// Within a transaction, log what takes back <key, rid> being put
+		// on a leaf (inserted) or taken off it.  The leaf is still
+		// latched exclusively, so this gets into the log ahead of the
+		// leaf's update.
+		Status logUndo (bool inserted, const void *key, const RID rid);
+
+		// Whether <key, rid> is in the index.
+		Status hasEntry (const void *key, const RID rid, bool &found);
+
+		// Mark a freshly initialized page with this index's node layout.
+		void setLayout (SortedPage *page);
+
+		// A new page for a node of type ndtype, pinned, from this
+		// index's extent for such nodes.
+		Status newNode (NodeType ndtype, PageId &pageNo, Page *&page);
+
+		// The next page of extent, pinned; a used-up extent is first
+		// refilled with size pages, or fewer if the DB has no run that
+		// long.  releaseExtent gives back what is left of one.
+		static Status takePage (Extent &extent, int size, PageId &pageNo,
+				Page *&page);
+		static Status releaseExtent (Extent &extent);
+
+		// Put a node that was merged into its left sibling, pinned and
+		// latched exclusively, on the header's list of free nodes, which
+		// newNode takes pages from once nobody has them pinned.  The node
+		// is marked dead (see SortedPage::set_dead); it is not handed
+		// back to the DB, as readers that were sent to it before it died
+		// may still pin it, until destroyFile.
+		Status freeNode (SortedPage *page);
+
+		// The latch of a pinned page of this index (see PageLatch).
+		static PageLatch *latchOf (void *page);
+
+		// Optimistic descent to the leaf for key (the leftmost one if key
+		// is NULL): *pleaf comes back pinned but not latched, along with
+		// the version of its latch at which it was the right leaf (if
+		// pversion is not NULL).  With run set, a separator equal to key
+		// sends us left, as for findRunStart; otherwise right, as for
+		// insert.  *pleaf is NULL if the tree is empty.
+		Status descend (const void *key, bool run, BTLeafPage **pleaf,
+				uint64_t *pversion);
+
+		// Follow right links from the latched page *ppage for as long as
+		// key is beyond its high key (see SortedPage::past_high_key).
+		Status moveRight (SortedPage **ppage, const void *key, bool run,
+				bool exclusive);
+
+		// The exclusive latches an insert that may split holds on its way
+		// down: the header's (for the root) and those of the pages on the
+		// path below it.  Once a page is latched that will not split, the
+		// latches above it are let go (releaseAbove).
+		struct LatchPath {
+			PageLatch *held[MAX_TREE_HEIGHT + 1];
+			int        n;
+
+			LatchPath() : n(0) {}
+			~LatchPath() { releaseAll(); }
+			int  push (PageLatch *latch);
+			void releaseAbove (int level);
+			void release (int level);
+			void releaseAll ();
+		};
+
+		// Will page take <key, ...> (or an index entry for a split below
+		// it) without splitting?
+		bool safeForInsert (SortedPage *page, const void *key);
+
 		// Recursively insert a new data entry <key,rid> ,
 		// returning pushed-up/copied-up index page entry (*goingUp)
 		// when we split (*goingUp is NULL when split stops).
-		// Inserts onto page currentPageId.
+		// Inserts onto page currentPageId, latch-coupling on path.
 		Status _insert (const void    *key,
 				const RID     rid,
 				KeyDataEntry  **goingUp,
 				int           *goingUpSize,
-				PageId        currentPageId);
+				PageId        currentPageId,
+				LatchPath     &path);
+
+		// Is there room on leaf page leafPage for one more entry with key?
+		bool hasRoom (BTLeafPage *leafPage, const void *key);
+
+		// Split full leaf page leafPage while inserting <key, rid>;
+		// *goingUp gets the index entry for the new right page.
+		Status splitLeaf (BTLeafPage *leafPage, const void *key,
+				const RID rid, KeyDataEntry *goingUp, int *goingUpSize);
+
+		// Split full index page indexPage while inserting <key, pageNo>,
+		// pageNo having been split off child left; *goingUp gets the
+		// entry pushed up to the parent.
+		Status splitIndex (BTIndexPage *indexPage, const void *key,
+				PageId pageNo, PageId left, KeyDataEntry *goingUp,
+				int *goingUpSize);
+
+		// The index entry <key, page> for a page split off during
+		// insertBatch; it goes right after left's.
+		struct BatchSep {
+			Keytype key;
+			PageId  page;
+			PageId  left;
+		};
+
+		// insertBatch's way with a full leaf: latch the path down to the
+		// leaf for keys[order[next]], split the leaf in place while adding
+		// the entries that follow and belong there, and take all the
+		// separators up in one pass.  next is moved past what went in.
+		Status splitBatch (const void *keys[], const RID rids[], int *order,
+				int n, int &next);
+		Status _splitBatch (const void *keys[], const RID rids[],
+				int *order, int n, int &next, int maxSplits, BatchSep *up,
+				int &nup, PageId currentPageId, LatchPath &path);
+
+		// Go right from the latched page *ppage, split off home, until
+		// key is not beyond its high key; pages other than home are
+		// latched and unlatched here.
+		Status batchMoveRight (SortedPage *home, SortedPage **ppage,
+				const void *key);
+
+		// Space entries keys[from..to) would use on an empty page with
+		// high key highKey (NULL for none).
+		int nodeBytes (Keytype *keys, int from, int to, NodeType ndtype,
+				const void *highKey);
+
+		// lookupMany's work on a leaf: look up keys[order[from..to)]
+		// (sorted) on the pinned leaf leafPage and the leaves after it.
+		Status lookupLeaf (BTLeafPage *leafPage, const void *keys[],
+				int *order, int from, int to, LookupResults &results);
 
 		Status fullDelete(const void *key, const RID rid);
 
-		Status naiveDelete(const void *key, const RID rid);
+		// Delete <key, rid> from its leaf.  *underfull (if not NULL) is
+		// set if the leaf was left underfull; only a hint, as the leaf
+		// is let go of before we return.
+		Status naiveDelete(const void *key, const RID rid,
+				bool *underfull = NULL);
+
+		// Is page, losing lose more bytes, underfull (see MERGE_FILL)?
+		bool underfull (SortedPage *page, int lose = 0);
 
+		// Will page not become underfull whatever a rebalance below it
+		// does (the root may shrink to one child)?
+		bool safeForDelete (SortedPage *page, bool root);
+
+		// Rebalance the tree for a delete of key after the fact: latch
+		// the path from currentPageId down to key's leaf exclusively, as
+		// _insert does, and merge or redistribute every underfull page
+		// on the way back up.  needsRebalance tells the caller whether
+		// currentPageId is left underfull.
 		Status _delete (const void    *key,
-				const RID     rid,
-				void          *&oldChildEntry,
 				PageId        currentPageId,
-				PageId        parentPageId);
+				LatchPath     &path,
+				bool          &needsRebalance);
+
+		// Merge or even out the child of the latched index page parent
+		// that key belongs to and its sibling, if either is underfull.
+		Status rebalance (BTIndexPage *parent, const void *key);
+
+		// Move entries from rp to its left sibling lp, evening the two
+		// out or, with slack set, filling lp up to slack bytes free; rp
+		// is first replaced by a copy, newId.
+		Status feedLeft (BTIndexPage *parent, SortedPage *lp,
+				SortedPage *rp, const void *sep, int slack, PageId &newId);
+
+		// Move all of rp's entries onto its left sibling lp, if they fit
+		// (merged is then set); both pages are latched exclusively.  For
+		// index pages sep is rp's key in the parent, which comes down.
+		Status mergeLeaf (BTLeafPage *lp, BTLeafPage *rp, bool &merged);
+		Status mergeIndex (BTIndexPage *lp, BTIndexPage *rp, const void *sep,
+				bool &merged);
+
+		// reorganize helpers.  reorgStep latches its way down to the
+		// parent of the next nodes of the pass and has reorgChildren
+		// merge and move them, budget being what is left of maxPages;
+		// moveNode copies a node to the reorganize extent and puts the
+		// copy in its place, and setBackLink points the leaf after it
+		// at the copy; placed tells whether a node is where the
+		// pass would put it.  treeHeight counts the levels, and
+		// releaseFreeNodes gives the free nodes back to the DB.
+		Status reorgStep (int fill_factor, int &budget, bool &done);
+		Status reorgChildren (BTIndexPage *parent, int fill_factor,
+				int &budget);
+		Status moveNode (SortedPage *page, SortedPage *left,
+				BTIndexPage *parent, PageId &newId);
+		Status setBackLink (PageId pageno, PageId prev);
+		bool placed (SortedPage *page);
+		Status treeHeight (int &height);
+		Status releaseFreeNodes ();
 
 
 		// findRunStart:  return the pinned page containing the left-most
 		// occurrence of key value `lo_key'.  Also returns the RID (in the data
-		// entry) corresponding to the first occurrence of key lo_key.
+		// entry) corresponding to the first occurrence of key lo_key, and
+		// the version of the page's latch at which that was so.
 		//
 		// This function is somewhat complex due to the fact that we handle
-		// duplicates (EC 1) and the fact that we don't do the standard delete
-		// algorithm and so some leaf pages may become empty.
-		Status findRunStart (const void *lo_key, BTLeafPage **ppage, RID *prid);
+		// duplicates (EC 1) and the fact that under NAIVE_DELETE some leaf
+		// pages may become empty.
+		Status findRunStart (const void *lo_key, BTLeafPage **ppage, RID *prid,
+				uint64_t *pversion = NULL);
+
+		// Cut [lo_key, hi_key] into up to nparts ranges of about the same
+		// number of leaves: bounds[0..nbounds) come back in ascending
+		// order, strictly between lo_key and hi_key.
+		Status partition (const void *lo_key, const void *hi_key, int nparts,
+				Keytype *bounds, int &nbounds);
+
+		// bulkLoad helpers.  fits() tells whether an entry of entry_len bytes
+		// may still go on a page without exceeding the fill factor.
+		// bulkInsertSep() adds separator <key, child> to index level `level'
+		// of the right spine (spine[0] is the level just above the leaves);
+		// `left' is the page preceding `child' on the level below.  A full
+		// spine page is closed and a new one started, whose first key is
+		// pushed up one more level.  first[level] is set to the first page
+		// of a level when it is started.
+		bool fits(SortedPage *page, int entry_len, int fill_factor);
+		Status bulkInsertSep(BTIndexPage **spine, PageId *first, int &height,
+				int level, const void *key, PageId left, PageId child,
+				int fill_factor);
+
+		// The leaf level as bulkLoad writes it, left to right; only the
+		// last leaf is pinned.  appendLeaf() adds <key, rid> to the last
+		// leaf, or to a new one if it does not fit.  In that case the old
+		// leaf is closed and comes back in closed, with the separator in
+		// front of the new leaf in *sep; otherwise closed is INVALID_PAGE.
+		// The leaves come out of an extent of the level's own, so that
+		// the ranges of a parallel build do not take turns in one; what
+		// is left of it goes back when the level does.
+		struct LeafLevel {
+			BTLeafPage *leafp;      // last leaf; NULL before the first entry
+			PageId      leafId;
+			PageId      firstId;    // first leaf
+			Keytype     firstKey;   // first and last key added
+			Keytype     lastKey;
+			Extent      extent;
+
+			LeafLevel() : leafp(NULL), leafId(INVALID_PAGE),
+				firstId(INVALID_PAGE)
+			{ extent.next = extent.end = INVALID_PAGE; }
+			~LeafLevel() { releaseExtent(extent); }
+		};
+
+		Status appendLeaf(LeafLevel &leaves, const void *key, RID rid,
+				int fill_factor, Keytype *sep, PageId &closed);
+
+		// Undo a bulkLoad that failed part way: unpin its pages and give
+		// every page it wrote back to the DB.  freeLevel() frees a level
+		// from its first page along the right links, up to last if given.
+		void bulkAbort(LeafLevel &leaves, BTIndexPage **spine, PageId *first,
+				int height);
+		void freeLevel(PageId pageno, PageId last = INVALID_PAGE);
+
+		// Parallel build (see build).  Each key range of the sort has its
+		// leaves written by a thread of its own (leafWorker, buildLeaves),
+		// which keeps the separators of its leaves in memory, packed as
+		// <key, pageNo> index entries.  buildParallel then chains the
+		// ranges' leaves together and feeds all the separators to
+		// bulkInsertSep, in key order.
+		struct LeafChain {
+			BTreeFile       *tree;
+			SortedKeySource *source;
+			int              fill_factor;
+			pthread_t        thread;
+			bool             started;
+			Status           status;
+
+			LeafLevel        leaves;
+			char            *seps;
+			int              sepsused;
+			int              maxseps;
+		};
+
+		Status buildParallel(KeySource *source, int sortpages,
+				int fill_factor, int nworkers);
+		Status buildLeaves(LeafChain &chain);
+		static void *leafWorker(void *arg);
 
 		// _destroyFile: recursively destroy the tree rooted at a specified page.
 		Status _destroyFile (PageId pageno);
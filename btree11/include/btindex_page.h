@@ -60,6 +60,16 @@ class BTIndexPage : public SortedPage {
 		Status insertKey(const void *key, AttrType key_type,
 				PageId pageNo, RID& rid);
 
+		// ------------------- insertKeyAfter -------------------
+		// Like insertKey, but among entries with a key equal to `key'
+		// the new one goes right after the entry for child left (first
+		// of them if left is the left link): the new child was split
+		// off left, and equal separators must keep the children in
+		// sibling order.
+
+		Status insertKeyAfter(const void *key, AttrType key_type,
+				PageId pageNo, PageId left, RID& rid);
+
 		// ------------------ OPTIONAL: deletekey ------------------
 		// This is optional, and is only needed if you want to do full deletion.
 		Status deleteKey(const void *key, AttrType key_type, RID& curRid);
@@ -72,8 +82,26 @@ class BTIndexPage : public SortedPage {
 
 		Status get_page_no(const void *key, AttrType key_type, PageId & pageNo);
 
-		bool get_sibling(const void *key, AttrType key_type,
-				PageId & pageNo, int &left);
+		// ------------------ get_run_page_no -------------------
+		// Like get_page_no, except that on a key equal to `key' it
+		// follows the pointer to the left of it: a run of duplicates of
+		// `key' may start at the end of that child.  Used to find the
+		// left-most occurrence of a key.
+
+		Status get_run_page_no(const void *key, AttrType key_type,
+				PageId & pageNo);
+
+		// ------------------ peek_page_no ----------------------
+		// get_page_no (get_run_page_no if run) for a page that may be
+		// changing while we look (see BTreeFile::descend), read straight
+		// from the page: a binary search that reads only the slots it
+		// compares and the child pointer, and never outside the page.
+		// What it finds means something only if the page did not change
+		// meanwhile; a page caught halfway through a change may also
+		// give false.
+
+		bool peek_page_no(const void *key, AttrType key_type, bool run,
+				PageId & pageNo);
 
 		// ------------------- Iterators ------------------------
 		// The two functions: get_first and get_next provide an
@@ -97,12 +125,46 @@ class BTIndexPage : public SortedPage {
 		PageId getLeftLink(void) { return getPrevPage(); }
 		void   setLeftLink(PageId left) { setPrevPage(left); }
 
-		Status adjust_key(const void *newKey, const  void *oldKey,
-				AttrType key_type);
+		// ------------------- Right Link -----------------------
+		// Like a leaf, an index page is linked to its right sibling on
+		// the same level, through the next page pointer.  A search key
+		// past the page's high key (see SortedPage::set_high_key) is to
+		// be looked for over there.
+
+		PageId getRightLink(void) { return getNextPage(); }
+		void   setRightLink(PageId right) { setNextPage(right); }
+
+		// ------------------ get_sibling -----------------------
+		// The page next to the child get_page_no(key) finds, under the
+		// same parent: the one left of it (left = 1) if there is one,
+		// else the one right of it (left = 0).  False if the page has
+		// just the left link.
+
+		bool get_sibling(const void *key, AttrType key_type,
+				PageId & pageNo, int &left);
+
+		// ------------------ redistribute ----------------------
+		// Move entries from this page to its sibling pptr, the right
+		// one if left is 1 and the left one if it is 0 (this page must
+		// then be a copy no reader can have been sent to yet), through
+		// parentPtr, where sep is the right page's key.  The two are
+		// evened out, or with slack set, pptr is filled up to slack
+		// bytes free.  False if none could be moved.
 
 		bool redistribute(BTIndexPage *pptr, BTIndexPage *parentPtr,
 				AttrType key_type,
-				int left, const void *deletedKey);
+				int left, const void *sep, int slack = -1);
+
+		// ------------------ findChild -------------------------
+		// The rid and key of the entry for child pageNo; false if
+		// there is none.
+
+		bool findChild(PageId pageNo, RID &rid, void *key);
+
+		// ------------------ set_child -------------------------
+		// Point the entry at rid to child pageNo instead, in place.
+
+		void set_child(const RID &rid, PageId pageNo);
 
 		Status findKey(void *key, void *entry, AttrType key_type);
 
@@ -95,6 +95,38 @@ class BTLeafPage : public SortedPage {
 
 		Status get_current (RID rid, void *key, RID & dataRid);
 
+		/*
+		 * find_key positions rid on the first entry whose key is not less
+		 * than `key' and returns that entry like get_current does
+		 * (NOMORERECS, with rid one past the last slot, if every key on
+		 * the page is smaller).  Binary search over the slot directory;
+		 * PACKED_KEYS pages use packed_rank instead.
+		 */
+
+		Status find_key (const void *key, AttrType key_type, RID& rid,
+				void *curkey, RID & dataRid);
+
+		/*
+		 * set_prefixed turns a freshly initialized leaf of an attrString
+		 * index into a front-coded page: the longest prefix shared by all
+		 * its keys is stored once at the start of data[], and each entry
+		 * holds only <suffix, dataRid>.  The prefix shrinks as keys that
+		 * do not share it are inserted.  The iterators and find_key hide
+		 * the encoding; callers always see whole keys.
+		 */
+
+		void set_prefixed();
+
+		/*
+		 * insert_cost -- bytes of record space (not counting the slot)
+		 * that insertRec(key) would use up on this page.  On a front-coded
+		 * page that includes re-expanding the other entries when the key
+		 * does not share the page prefix; insertRec fails if it is more
+		 * than available_space().
+		 */
+
+		int insert_cost(const void *key, AttrType key_type);
+
 		// ------------------- get_data_rid ------------------------
 		// This function performs a sequential search (or a binary search
 		// if you are ambitious) to find a data entry of the form <key, dataRid>,
@@ -115,8 +147,36 @@ class BTLeafPage : public SortedPage {
 
 		bool delUserRid (const void *key, AttrType key_type, const RID& dataRid);
 
-		bool redistribute (BTLeafPage* page, BTIndexPage* parentpage,
-				AttrType key_type, int left, const void *deleted_key);
+		/*
+		 * redistribute -- move entries from this page to its sibling
+		 * pptr, the right one if left is 1 and the left one if it is 0
+		 * (this page must then be a copy no reader can have been sent
+		 * to yet), and put the new separator in the parent, in place of
+		 * the right page's key.  The two are evened out, or with
+		 * slack set, pptr is filled up to slack bytes free.  False if
+		 * none could be moved.
+		 */
+
+		bool redistribute (BTLeafPage* pptr, BTIndexPage* parentPtr,
+				AttrType key_type, int left, int slack = -1);
+
+	private:
+
+		/*
+		 * get_entry unpacks the entry in slot slotno into *key (the whole
+		 * key, prefix included) and dataRid.
+		 */
+
+		void get_entry (int slotno, void *key, RID & dataRid);
+
+		// front-coding helpers: the page prefix is the NUL-terminated
+		// string at the start of the record area (just past the high
+		// key, if any).  set_prefix re-encodes the page with the first
+		// newlen bytes of newprefix as its prefix, which must be a
+		// prefix of every key on the page.
+		const char *prefix () { return data + records_start(); }
+		int  prefix_len ();
+		void set_prefix (const char *newprefix, int newlen);
 
 };
 
@@ -23,6 +23,7 @@ class BTreeFileScan : public IndexFileScan {
 
 	public:
 		friend class BTreeFile;
+		friend class BTreeParallelScan;
 
 		// get the next record. NOTE: returns DONE instead of NOMORERECS when
 		// finished.  (Our page code returns NOMORERECS in accordance with
@@ -30,6 +31,13 @@ class BTreeFileScan : public IndexFileScan {
 		// probably be looking for NOMORERECS, but a workaround is easy enough.)
 		Status get_next(RID & rid, void* keyptr);
 
+		// get up to max next records at once: rids[0..n) and n keys of
+		// keysize() bytes each, back to back in keys.  The range end is
+		// checked once per leaf where possible.  Returns DONE (with n = 0)
+		// once the scan is finished.  Mixes freely with get_next and
+		// delete_current, which work on the last record returned.
+		Status get_next_batch(RID *rids, void *keys, int max, int &n);
+
 		// delete the record currently scanned
 		Status delete_current();
 
@@ -54,6 +62,44 @@ class BTreeFileScan : public IndexFileScan {
 		// (that is, implement an inclusive range
 		// scan -- the only way to do a search for
 		// a single value).
+		bool endopen;               // endkey itself is not in the range
+		// (set by BTreeParallelScan).
+
+		// leaf read-ahead: the leaves in front of the scan are handed to
+		// BufMgr::prefetchPages while it is still working on this one.
+		// The window doubles (up to MAX_READAHEAD pages) for as long as
+		// each next leaf is the page right after the current one, and
+		// drops back to a single page as soon as it is not.
+		enum { MAX_READAHEAD = 32 };
+
+		int readahead;              // current window, in pages
+		PageId readaheadEnd;        // pages before this have been prefetched
+
+		// called every time leafp moves on to a new leaf
+		void readAhead();
+
+		// Other threads may change the leaf between two calls; it is
+		// only latched (shared) within a call.  If its version moved on
+		// since the last call, the scan finds its place again by the
+		// entry it was on: lastKey and lastData are the entry last
+		// returned or, when the next one is at curRid (atCurrent), that
+		// one.  The same is done on each new leaf, to which entries may
+		// have moved from the one before.
+		uint64_t leafVersion;
+		Keytype  lastKey;
+		RID      lastData;
+
+		// Under FULL_DELETE the leaf may be merged away meanwhile (see
+		// BTreeFile::freeNode); relocate then finds lastKey again from
+		// the top.  nextLeaf moves on along the leaf chain.
+		Status relocate();
+		Status nextLeaf(PageId nextpage);
+
+		bool   pastEnd(const void *key);
+		bool   atCurrent();
+		Status advance(void *keyptr, RID &dataRid);
+		bool   seek(bool sameLeaf, bool returned);
+		void   remember(const void *key, RID dataRid);
 };
 
 #endif  // _BTREE_FILESCAN_H
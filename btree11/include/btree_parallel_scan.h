@@ -0,0 +1,125 @@
+/* -*- C++ -*- */
+/*
+ * btree_parallel_scan.h - definition of class BTreeParallelScan
+ */
+
+#ifndef _BTREE_PARALLEL_SCAN_H
+#define _BTREE_PARALLEL_SCAN_H
+
+#include <pthread.h>
+
+#include "minirel.h"
+#include "index.h"
+#include "bt.h"
+
+class BTreeFile;
+class BTreeFileScan;
+
+/*
+ * BTreeParallelScan is a range scan of a BTreeFile run by several
+ * threads (see BTreeFile::new_parallel_scan).
+ *
+ * The range is cut into disjoint key ranges at keys taken from the top
+ * levels of the tree (see BTreeFile::partition), and each of them is
+ * scanned by a worker thread with a BTreeFileScan of its own.  A worker
+ * fills batches of up to BATCH_SIZE entries with get_next_batch and
+ * queues them; it runs at most QUEUE_DEPTH batches ahead of the caller.
+ *
+ * The caller takes the batches as they are (next_batch) or entry by
+ * entry (get_next).  Unordered, it gets whichever batch is ready first,
+ * so entries from different ranges come interleaved.  Ordered, the
+ * ranges are handed out one after the other; since they are disjoint
+ * and in ascending key order that is the key order of the whole scan,
+ * and the workers for later ranges still read ahead meanwhile.
+ *
+ * The scan is read-only: delete_current fails.  Destroying the scan
+ * stops the workers.  BTreeParallelScan uses the BTREE error table.
+ */
+
+class BTreeParallelScan : public IndexFileScan {
+
+	public:
+		// scan [lo_key, hi_key] of tree (either may be NULL, as for
+		// new_scan) in the ranges that bounds[0..nbounds) cut it into
+		BTreeParallelScan(Status& status, BTreeFile *tree,
+				const void *lo_key, const void *hi_key,
+				const Keytype *bounds, int nbounds, bool ordered);
+
+		// stops and waits for the workers
+		~BTreeParallelScan();
+
+		// next entry (DONE at the end)
+		Status get_next(RID &rid, void* keyptr);
+
+		// next batch: n entries, their data RIDs at rids and their keys
+		// at keys, keysize() bytes apart; *part (if not NULL) is the
+		// number of the range they come from.  The batch stays valid up
+		// to the next call.  DONE (with n = 0) at the end.
+		Status next_batch(const RID *&rids, const void *&keys, int &n,
+				int *part = NULL);
+
+		// not supported
+		Status delete_current();
+
+		int keysize();
+
+		// number of ranges (and workers)
+		int partitions() { return nparts; }
+
+	private:
+
+		enum { BATCH_SIZE = 256, QUEUE_DEPTH = 4 };
+
+		struct Batch {
+			RID   *rids;
+			char  *keys;
+			int    n;
+			Batch *next;
+		};
+
+		// one key range and the worker scanning it; all but the worker's
+		// scan is guarded by lock
+		struct Part {
+			BTreeParallelScan *owner;
+			int        id;
+			const void *lo;     // lo_key or a bound
+			const void *hi;     // hi_key or a bound
+			bool       hiOpen;  // hi itself is not in the range
+			pthread_t  thread;
+			bool       started;
+
+			Batch     *head;    // queued batches, oldest first
+			Batch     *tail;
+			Batch     *free;    // batches the worker may fill
+			bool       done;    // no more batches will be queued
+			Status     status;  // how the worker ended
+		};
+
+		BTreeFile *treep;
+		AttrType   key_type;
+		int        stride;      // keysize()
+		bool       ordered;
+		bool       stopping;    // set by the destructor
+
+		Keytype   *bounds;      // [nparts-1] copies of the bounds
+		Keytype    loKey;
+		Keytype    hiKey;
+
+		Part      *parts;
+		int        nparts;
+		int        nextPart;    // the part to look at first for a batch
+
+		pthread_mutex_t lock;
+		pthread_cond_t  ready;  // a batch was queued or a part is done
+		pthread_cond_t  space;  // a batch was given back, or stopping
+
+		Batch     *cur;         // batch the caller is on, or NULL
+		Part      *curPart;
+		int        curPos;      // next entry of cur for get_next
+
+		static void *work(void *arg);
+		Status scanPart(Part *part);
+		void   release();
+};
+
+#endif  // _BTREE_PARALLEL_SCAN_H
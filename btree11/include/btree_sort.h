@@ -0,0 +1,259 @@
+/* -*- C++ -*- */
+/*
+ * btree_sort.h - definition of class BTreeSort
+ */
+
+#ifndef _BTREE_SORT_H
+#define _BTREE_SORT_H
+
+#include <pthread.h>
+
+#include "minirel.h"
+#include "hfpage.h"
+#include "index.h"
+#include "bt.h"
+
+/*
+ * BTreeSort is an external merge sort of <key, rid> pairs, used to build
+ * an index from unsorted input (see BTreeFile::build).
+ *
+ * The constructor drains the KeySource.  Pairs are collected in a work
+ * area of `sortpages' pages; every time it fills up it is sorted and
+ * written out as a sorted run.  A run is a temporary chain of HFPages
+ * (linked through nextPage) holding packed <key, rid> entries.  Runs are
+ * then merged sortpages-1 at a time until one more merge is enough, and
+ * that last merge is not written out: get_next produces it on demand,
+ * so it flows straight into the leaf pages of BTreeFile::bulkLoad.
+ *
+ * Run pages are freed as soon as the merge has read past them.  If the
+ * input fits in the work area no run is written at all.
+ *
+ * BTreeSort uses the BTREE error table.
+ */
+
+class BTreeSort : public SortedKeySource {
+
+	public:
+		BTreeSort(Status& status, KeySource *source, AttrType key_type,
+				int sortpages);
+
+		// frees the work area and whatever run pages were not consumed
+		~BTreeSort();
+
+		// next pair in ascending key order; DONE at the end
+		Status get_next(RID &rid, void* keyptr);
+
+	private:
+
+		// read position in a run being merged; page stays pinned and
+		// rec points at the current <key, rid> entry on it
+		struct RunCursor {
+			PageId  pageNo;     // INVALID_PAGE once the run is used up
+			HFPage *pagep;
+			RID     curRid;
+			char   *rec;
+			int     reclen;
+		};
+
+		// write position in a run being produced; tail stays pinned
+		struct RunWriter {
+			PageId  head;
+			PageId  tail;
+			HFPage *pagep;
+		};
+
+		AttrType   key_type;
+		int        sortpages;   // memory budget, in pages
+
+		char      *work;        // [sortpages * MINIBASE_PAGESIZE] entries
+		int       *entries;     // offsets of the entries in work[]
+		int        nentries;
+		int        workused;    // bytes of work[] in use
+		int        nextentry;   // in-memory result: next entry to return
+		bool       inmemory;    // true if the input was never spilled
+
+		PageId    *runs;        // first pages of the runs on disk
+		int        nruns;
+		int        maxruns;
+
+		RunCursor *cursors;     // [sortpages-1] final merge inputs
+		int        ncursors;
+
+		Status makeRuns(KeySource *source);
+		void   sortWork();
+		Status spillWork();
+		Status addRun(PageId head);
+		Status mergePass();
+		Status mergeRuns(PageId *in, int n, PageId &out);
+
+		// run primitives, shared with BTreeParallelSort
+		friend class BTreeParallelSort;
+
+		static Status openRun(RunCursor &cur, PageId head);
+		static Status advance(RunCursor &cur);
+		static void   dropRun(RunCursor &cur);
+		static int    pickMin(RunCursor *cur, int n, AttrType key_type);
+
+		static Status openWriter(RunWriter &w);
+		static Status append(RunWriter &w, char *rec, int reclen);
+		static Status closeWriter(RunWriter &w);
+		static void   dropWriter(RunWriter &w);
+		static Status freeRun(PageId head);
+};
+
+/*
+ * BTreeParallelSort is the sort behind a parallel build (see
+ * BTreeFile::build): a sample sort by nworkers threads that leaves its
+ * output cut into key ranges, so that the leaves of each range can be
+ * written by a thread of its own.
+ *
+ * The workers take turns reading the KeySource, a batch at a time, into
+ * work areas of their own (sortpages/nworkers pages each).  Each one
+ * sorts its full work area and writes it out as a run, noting the first
+ * key of every run page (so a key can be found in the run without
+ * reading it) and regularly spaced samples of the keys.  At the end a
+ * worker merges its runs until there are few enough to be merged all at
+ * once within its share of the pages.
+ *
+ * The samples of all runs then give nworkers-1 bounds that cut the keys
+ * into ranges of about the same size (duplicate bounds are dropped, so
+ * there may be fewer ranges), and partition(i) merges range i out of all
+ * runs.  Only the pages of the runs holding a range are read for it, and
+ * the runs are freed when the sort is destroyed.
+ *
+ * BTreeParallelSort uses the BTREE error table.
+ */
+
+class BTreeParallelSort {
+
+	public:
+		BTreeParallelSort(Status& status, KeySource *source,
+				AttrType key_type, int sortpages, int nworkers);
+
+		// frees the runs; the partitions must not be in use any more
+		~BTreeParallelSort();
+
+		// number of key ranges
+		int partitions() { return nparts; }
+
+		// the pairs of range i in ascending key order.  The ranges are
+		// disjoint and ascending, and may be read at the same time by
+		// different threads.
+		SortedKeySource *partition(int i);
+
+	private:
+
+		// regular samples: every run contributes this many per range
+		enum { SAMPLES_PER_PART = 8 };
+
+		// pairs read from the source per turn
+		enum { READ_BATCH = 256 };
+
+		// a page of a run and the offset of its first key in keys[]
+		struct RunPage {
+			PageId pageNo;
+			int    keyoff;
+		};
+
+		// a sorted run on disk and its page directory
+		struct Run {
+			RunPage *pages;
+			int      npages;
+			int      maxpages;
+			char    *keys;
+			int      keysused;
+			int      maxkeys;
+		};
+
+		// a sample key, standing for weight keys of its run
+		struct Sample {
+			int keyoff;     // in the worker's samplekeys[]
+			int weight;
+		};
+
+		struct Worker {
+			BTreeParallelSort *owner;
+			pthread_t thread;
+			bool      started;
+			Status    status;
+
+			char     *work;       // work area, as in BTreeSort
+			int      *entries;
+			int       nentries;
+			int       workused;
+
+			Run      *runs;
+			int       nruns;
+			int       maxruns;
+
+			Sample   *samples;
+			int       nsamples;
+			int       maxsamples;
+			char     *samplekeys;
+			int       samplekeysused;
+			int       maxsamplekeys;
+		};
+
+		// where a partition is in one run: like BTreeSort::RunCursor,
+		// but the pages are walked through the run's directory and not
+		// freed, since the partitions next to it read them too
+		struct RangeCursor {
+			Run    *run;
+			int     page;       // index into run->pages; npages at the end
+			HFPage *pagep;      // pinned while page < run->npages
+			RID     curRid;
+			char   *rec;
+			int     reclen;
+		};
+
+		// key range [lo, hi) of the output; lo is NULL for the first
+		// range and hi for the last
+		class Part : public SortedKeySource {
+			public:
+				Status get_next(RID &rid, void* keyptr);
+
+				BTreeParallelSort *owner;
+				const void  *lo;
+				const void  *hi;
+				RangeCursor *cursors;
+				int          ncursors;
+				bool         opened;
+
+				Status open();
+				Status seek(RangeCursor &cur);
+				Status advance(RangeCursor &cur);
+				void   close();
+		};
+
+		AttrType   key_type;
+		int        workpages;   // per worker
+
+		KeySource *source;      // read under sourceLock
+		pthread_mutex_t sourceLock;
+		bool       sourceDone;
+		Status     sourceStatus;
+
+		Worker    *workers;
+		int        nworkers;
+
+		Keytype   *bounds;      // [nparts-1]
+		Part      *parts;
+		int        nparts;
+
+		static void *work(void *arg);
+		Status sortRuns(Worker &w);
+		Status fill(Worker &w);
+		Status spill(Worker &w);
+		Status mergeDown(Worker &w, int maxruns);
+		Status mergeRuns(Worker &w, Run *in, int n, Run &out);
+		void   pickBounds();
+
+		Status openRun(Run &run, BTreeSort::RunWriter &wr);
+		Status appendRun(Run &run, BTreeSort::RunWriter &wr, char *rec,
+				int reclen);
+		void   addSample(Worker &w, char *rec, int weight);
+		static void freeDirectory(Run &run);
+		static void freeRunPages(Run &run);
+};
+
+#endif  // _BTREE_SORT_H
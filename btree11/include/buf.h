@@ -1,7 +1,10 @@
-
 #ifndef _BUF_H
 #define _BUF_H
 
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
 #include "db.h"
 #include "page.h"
 
@@ -10,6 +13,7 @@
 // **************** ALL BELOW are purely local to buffer Manager ********
 // class for maintaining information about buffer pool frame
 class BufMgr;
+class RecoveryMgr;
 
 #define REPLACER Clock  // This is the default replacement policy.  You
                         // may specify a different policy when you create
@@ -29,68 +33,149 @@ enum bufErrCodes  {
 	BAD_BUF_FRAMENO,
 	PAGE_NOT_FOUND,
 	FRAME_EMPTY,
+	THREAD_ERROR,
 };
 
 
 // *****************************************************
+// A latch on the page in a frame, for callers that share pages between
+// threads (the B+ tree does).  Besides shared and exclusive holds it has
+// a version that every exclusive hold moves on, so a page can also be
+// read without latching it at all: note the version (readVersion), read,
+// and check that the version is still the same (validate).  The version
+// is odd while the latch is held exclusively.  Only a pinned page may be
+// latched, and a latch is released before the page is unpinned.
+class PageLatch {
+
+	public:
+		PageLatch() : version(0), readers(0) {}
+
+		uint64_t readVersion();              // waits while held exclusively
+		bool     validate( uint64_t v ) { return version == v; }
+
+		void     lockShared();
+		bool     tryLockShared();            // fails if held exclusively
+		void     unlockShared() { readers--; }
+		// the version, for a shared holder: an exclusive holder may be
+		// waiting for us, but has not changed anything yet
+		uint64_t sharedVersion() { return version & ~(uint64_t) 1; }
+		uint64_t lockExclusive();            // returns the version it was at
+		bool     upgrade( uint64_t v );      // lockExclusive, if still at v
+		uint64_t unlockExclusive() { return ++version; }  // new version
+
+	private:
+		std::atomic<uint64_t> version;
+		std::atomic<int>      readers;
+};
+
+// *****************************************************
+// The buffer manager may be used by several threads at once.  A frame's
+// pin count, a "claimed" bit and the number of times it was pinned share
+// one word (pins), so that pinning a page that is in the pool is a
+// single atomic add; see BufMgr::pinPage.
 class FrameDesc {
 
 	friend class BufMgr;
+	friend class Clock;
 
 	private:
-	int    pageNo;     // the page within file, or INVALID_PAGE if
+	std::atomic<int> pageNo;     // the page within file, or INVALID_PAGE if
 	// the frame is empty.
 
-	unsigned int pin_cnt;  // The pin count for the page in this frame
+	std::atomic<uint64_t> pins;  // pin count (low 31 bits), CLAIMED, and
+	                             // the pin sequence number (high 32 bits)
+	uint32_t loadSeq;            // pin sequence when the page came in
 
+	std::atomic<int>  hashNext;  // next frame in the same hash chain, or -1
+	std::atomic<bool> loaded;    // false while the page is being read in
+	pthread_mutex_t   latch;     // guards the wait for loaded
+	pthread_cond_t    loadDone;  // loaded became true
+	PageLatch         pageLatch; // for the users of the page; see PageLatch
 
+	// asynchronous read-ahead into the frame, while it is claimed
+	IORequest         io;
+	int               ioPage;    // the page to read in
+	uint64_t          ioPins;    // pins when the old page went out
 
-	FrameDesc() {
-		pageNo  = INVALID_PAGE;
-		pin_cnt = 0;
-	}
+	// when logging: the page's last update ends here in the log, and
+	// an unpin could not look for changes (see BufMgr::logFrame)
+	std::atomic<uint64_t> lastLsn;
+	std::atomic<bool> unlogged;
 
-	~FrameDesc() {}
+	// the dirty bit: the unpins that said the page changed since it was
+	// last written (0 if none).  Only a write that no unpin marked while
+	// it was under way sets it back to 0 (see BufMgr::cleaned).
+	std::atomic<uint64_t> dirty;
+
+	// the page as it is on disk: its checksum, and the pin sequence when
+	// it was read or written (it cannot have changed unless pinned since);
+	// see BufMgr::isDirty.  onDisk is false for a new page, or when a
+	// write may have caught the page halfway through a change.
+	std::atomic<bool>     onDisk;
+	std::atomic<uint32_t> cleanSeq;
+	uint64_t              cleanSum;   // guarded by latch
+	std::atomic<bool>     cleaning;   // the cleaner is writing it
+
+	std::atomic<char>     refBit;     // Clock's reference bit
+
+	enum { CLAIMED = 0x80000000u };
+
+	FrameDesc();
+	~FrameDesc();
 
 	public:
-	int pin_count() { return(pin_cnt); }
-	int pin() { return(++pin_cnt); }
-	int unpin() {
-		pin_cnt = (pin_cnt <= 0) ? 0 : pin_cnt - 1;
-		return(pin_cnt);
+	int page_no() { return(pageNo); }
+
+	// number of pins; a claimed frame counts as pinned once
+	int pin_count() {
+		uint32_t low = (uint32_t) pins;
+		return (low & ~CLAIMED) + ((low & CLAIMED) ? 1 : 0);
 	}
+
+	// Takes a frame nobody has pinned for reuse (a replacer's victim):
+	// sets CLAIMED, which keeps other replacers off it.  Fails if the
+	// frame is pinned or claimed.
+	bool claim();
 };
 
 // *****************************************************
+// A Replacer chooses frames to reuse.  BufMgr calls pin when a pinPage
+// finds its page in the pool (the frame is pinned by then), unpin when
+// the pin count of a frame drops to zero and free when the page in a
+// frame is freed.  These calls may come from several threads at once.
 class Replacer {
 
 	public:
 		virtual int pin( int frameNo );
 		virtual int unpin( int frameNo );
 		virtual int free( int frameNo );
-		virtual int pick_victim() = 0;     // Must pin the returned frame.
+		virtual int pick_victim() = 0;     // Must claim the returned frame.
 		virtual const char *name() = 0;
-		virtual void info();
+		virtual void info();               // prints the hit ratio
+		// the frame the next victims are looked for after, or -1 if
+		// the policy does not go round the frames in order
+		virtual int  hand();
 
 		unsigned getNumUnpinnedBuffers();
 
+		// buffer pool hits (pinPage found the page) and misses
+		unsigned long hits();
+		unsigned long misses();
+		double hit_ratio();
+
 	protected:
 		Replacer();
 		virtual ~Replacer();
 
-		enum STATE {Available, Referenced, Pinned};
-
 		BufMgr *mgr;
 		friend class BufMgr;
 		virtual void setBufferManager( BufMgr *mgr );
-
-		// These variables are required for the clock algorithm.
-
-		int         head;           // Clock hand.
-		STATE      *state_bit;      // [numBuffers]
 };
 
 // *****************************************************
+// Clock.  Pinning a page only sets its reference bit (in the frame's
+// FrameDesc, next to the pin count the pin has just changed), without
+// taking a lock; the clock hand is moved under a lock, on misses only.
 class Clock : public Replacer {
 
 	public:
@@ -98,9 +183,18 @@ class Clock : public Replacer {
 		Clock();
 		~Clock();
 
+		int   pin( int frameNo );
+		int   free( int frameNo );
 		int   pick_victim();
 		const char *name() { return "Clock"; }
-		void  info();
+		int   hand();
+
+	protected:
+		void  setBufferManager( BufMgr *mgr );
+
+	private:
+		int                 head;       // Clock hand.
+		pthread_mutex_t     handLock;
 };
 
 // *****************************************************
@@ -109,15 +203,104 @@ class BufMgr {
 
 	private:
 		unsigned int    numBuffers;
-		Page           *bufPool;    // [numBuffers]; physical buffer pool
+		char           *bufPool;    // [numBuffers] pages; physical buffer pool
 
 		// An array of Descriptors one per frame.
 		FrameDesc      *frmeTable;  // [numBuffers]
 
 		Replacer       *replacer;
 
+		// The page -> frame hash table: chains of frames linked through
+		// FrameDesc::hashNext.  Lookups do not lock; a chain is changed
+		// only with the lock of its partition held.
+		enum { NUM_PARTITIONS = 64 };
+
+		unsigned int       hashSize;    // a power of 2
+		std::atomic<int>  *hashTable;   // [hashSize] first frame of each chain
+		pthread_mutex_t    partitions[NUM_PARTITIONS];
+
+		std::atomic<unsigned long> evictedHits;  // hits on pages since evicted
+		std::atomic<unsigned long> nmisses;
+
 		// Factor out the common code for the two versions of Flush
-		Status privFlushPages(int pageid, int all_pages=0);
+		Status privFlushPages(int pageid, int all_pages=0,
+				bool pinnedOK=false);
+
+		// The pools are arrays of pages of MINIBASE_PAGESIZE bytes,
+		// which are not known until the DB is there (see usePageSize).
+		// Whole pages are copied as bytes (bytesAt), a Page not being
+		// a plain struct.
+		static char *bytesAt(char *pool, int n)
+			{ return pool + (size_t) n * MINIBASE_PAGESIZE; }
+		static Page *pageAt(char *pool, int n)
+			{ return (Page *) bytesAt(pool, n); }
+		static int   pageIndex(const char *pool, const Page *page)
+			{ return ((const char *) page - pool) / MINIBASE_PAGESIZE; }
+
+		unsigned int hash(int pageNo) const;
+		pthread_mutex_t *partition(unsigned int bucket)
+			{ return &partitions[bucket & (NUM_PARTITIONS-1)]; }
+
+		int    lookup(int pageNo);
+		int    lockedLookup(int pageNo);
+		void   link(int frameNo, int pageNo);
+		void   unlink(int frameNo, int pageNo);
+		bool   pinResident(int frameNo, int pageNo);
+		void   release(int frameNo);
+		void   unclaim(int frameNo);
+		Status evict(int frameNo, bool &evicted);
+		bool   detach(int frameNo, int oldPage, uint64_t before);
+		bool   beginLoad(int frameNo, int pageNo);
+		void   endLoad(int frameNo, bool ok);
+
+		// what is on disk; see FrameDesc::onDisk
+		static uint64_t checksum(const Page *page);
+		bool   isDirty(int frameNo, uint64_t pins, uint64_t &sum,
+				uint64_t &marks);
+		void   cleaned(int frameNo, uint32_t seq, uint64_t sum,
+				uint64_t marks);
+		void   wrote(int frameNo, uint64_t pins, uint64_t sum,
+				uint64_t marks);
+
+		// the background writer; see buf_clean.C
+		pthread_t          cleaner;
+		bool               cleanerOn;
+		bool               cleanStop;
+		pthread_mutex_t    cleanLock;   // held by the cleaner at work
+		pthread_cond_t     cleanWake;
+		std::atomic<unsigned> lowMark, highMark;
+		unsigned int       cleanNext;   // where to look, without a hand
+		std::atomic<unsigned> dirtyEvictions;  // since the last round
+		char              *cleanCopies; // the pages of a round, as written
+
+		static void *clean(void *arg);
+		int    cleanBatch();
+
+		// read-ahead into frames; see buf_prefetch.C
+		bool   startRead(int frameNo);
+		static void prefetchWritten(IORequest *req);
+		static void prefetchRead(IORequest *req);
+
+		// Memory-mapped mode (see buf_map.C): the pages are the DB's
+		// mapping of its file, and the frames go unused.  A page is
+		// latched and pinned in arrays indexed by page number.
+		char              *mapBase;     // NULL unless mapped
+		unsigned int       mapPages;
+		std::atomic<int>  *mapPins;     // [mapPages]
+		PageLatch         *mapLatches;  // [mapPages]
+		std::atomic<int>   mapPinned;   // pages pinned at least once
+
+		// Logging (see recovery_mgr.h): each frame's page as it was
+		// last logged, to find the changes in.  NULL unless logging.
+		RecoveryMgr       *log;
+		char              *shadows;     // [numBuffers] pages
+
+		Status logFrame(int frameNo, bool wait, bool &done);
+
+		Status mapPin(int pageNo, Page*& page);
+		Status mapUnpin(int pageNo);
+		Status mapFree(int pageNo);
+		Status mapFlush(int pageid, int all_pages);
 
 	public:
 
@@ -152,20 +335,309 @@ class BufMgr {
 		Status freePage(int globalPageId);
 
 
+		// Start bringing in howmany pages from firstPageId on, ahead of
+		// the pinPage calls for them, without waiting: the ones not in
+		// the buffer pool are read into free frames by the DB's I/O
+		// queue, or, if the pool has none to spare, handed to
+		// DB::prefetch_pages.  Nothing is pinned.
+		Status prefetchPages(int firstPageId, int howmany=1);
+
 		// Added to flush a particular page of the buffer pool to disk
 		Status flushPage(int pageid);
 
 		// Flushes all pages of the buffer pool to disk
 		Status flushAllPages();
 
+		// The same, for a checkpoint of the log: pages pinned by others
+		// are written as they are, without complaint.
+		Status checkpointPages();
+
+
+		// Make the frames pages of size bytes, the DB's page size,
+		// which it then sets (MINIBASE_PAGESIZE).  The DB does this as
+		// it is created or opened, while the pool is still empty.
+		Status usePageSize(int size);
+
+		// Switch to memory-mapped mode: the npages pages of the DB are
+		// at base from now on.  The DB does this as it maps its file,
+		// while the pool is still empty.
+		Status useMapping(Page *base, unsigned int npages);
+		bool   mapped() const { return mapBase != NULL; }
+
+		// The background writer (see buf_clean.C): while fewer than
+		// lowMark unpinned frames hold clean pages, it writes dirty
+		// ones out, just ahead of the replacer, until highMark do, so
+		// that pinPage seldom has to write a page before reading one.
+		// Started by SystemDefs once the DB is open.  The marks may be
+		// changed at any time; a lowMark of 0 lets the writer rest.
+		Status startCleaner();
+		void   stopCleaner();
+		void   setCleanMarks(unsigned int lowMark, unsigned int highMark);
+
+		// Hand the changes made to pages from now on to log, which
+		// will be there until stopLogging.  Changes are looked for
+		// when a page is unpinned, and they go into the log before the
+		// page is written.  Not in mapped mode.
+		void   startLogging(RecoveryMgr *log);
+		void   stopLogging();
+		// log the changes to page, which is pinned, now
+		Status logChanges(Page *page);
+		// log the changes the unpins could not
+		Status logPending();
+		bool   inPool(Page *page) const
+			{ return (char *) page >= bufPool && (char *) page
+				< bufPool + (size_t) numBuffers * MINIBASE_PAGESIZE; }
 
 		unsigned int getNumBuffers() const { return numBuffers; }
 		unsigned int getNumUnpinnedBuffers();
 
+		// pinPage calls that found their page in the pool, and the
+		// ones that had to read it in
+		unsigned long getHits();
+		unsigned long getMisses() { return nmisses; }
+
+		// How many times pageId is pinned right now, 0 if it is not in
+		// the pool.  Only a hint: it may change as soon as it is read.
+		int    pinCount(int pageId);
+
+		// The latch of a page pinned at page.
+		PageLatch *pageLatch(Page *page)
+			{ return mapBase ? &mapLatches[pageIndex(mapBase, page)]
+				: &frmeTable[pageIndex(bufPool, page)].pageLatch; }
+
 		// A few routines currently need direct access to the FrameTable.
 		FrameDesc *frameTable() { return frmeTable; }
 };
 
+// *****************************************************
+// Base class of the replacement policies below.  It keeps track of
+// which page each frame holds: BufMgr fills a frame only after
+// pick_victim returned it, so the policy hears about the new page
+// (admit) on the first pin or unpin of the frame after that.  The
+// policies keep lists, so unlike Clock they do their work under one
+// lock.  Hits are not worth taking it for each: a thread records them
+// (with the page, which may have left the frame meanwhile) and hands
+// them to the policy HIT_BATCH at a time, or sooner if the lock happens
+// to be free, and before it looks for a victim (as in BP-Wrapper).
+// Frames without a page are kept on a list of their own.
+class PageReplacer : public Replacer {
+
+	public:
+		int  pin( int frameNo );
+		int  unpin( int frameNo );
+		int  free( int frameNo );
+		int  pick_victim();
+
+	protected:
+		PageReplacer();
+		~PageReplacer();
+
+		void setBufferManager( BufMgr *mgr );
+
+		int  numFrames() const { return nframes; }
+		int  pageOf( int frameNo );
+		int  pinCount( int frameNo );
+		bool pinned( int frameNo ) { return pinCount(frameNo) > 0; }
+
+		// The policy proper.  setup is called once the pool size is
+		// known.  victim picks an unpinned frame holding a page and
+		// forgets it, or returns -1; admit reports the page that came
+		// into a frame and touch a later pin of it; drop a frame that
+		// no longer holds its page.
+		virtual void setup( int numFrames ) = 0;
+		virtual int  victim() = 0;
+		virtual void admit( int frameNo, int pageNo ) = 0;
+		virtual void touch( int frameNo ) = 0;
+		virtual void drop( int frameNo ) = 0;
+
+	private:
+		enum FrameUse { Empty, Filling, Holding };
+		enum { HIT_BATCH = 64 };
+
+		struct HitBatch {
+			PageReplacer *owner;    // whose hits these are
+			int           n;
+			int           frame[HIT_BATCH];
+			int           page[HIT_BATCH];
+		};
+		static __thread HitBatch batch;
+
+		int                     nframes;
+		std::atomic<FrameUse>  *use;     // [numBuffers]
+		int                    *empty;   // [numBuffers] frames left Empty
+		int                     nempty;
+		pthread_mutex_t         lock;
+
+		void settle( int frameNo );
+		void emptied( int frameNo );
+		void applyHits();
+};
+
+// *****************************************************
+// A list of frames in recency order, head first, for the replacers
+// below.  A frame is on at most one list of a replacer at a time, so
+// all its lists share one set of links.
+class FrameList {
+
+	public:
+		FrameList() : head(-1), tail(-1), count(0), prev(0), next(0) {}
+
+		void init( int *prevLinks, int *nextLinks );
+
+		void push_front( int frameNo );
+		void remove( int frameNo );
+		int  size() const { return count; }
+
+		// nearest the tail, i.e. least recently used, that is not pinned
+		int  oldest_unpinned( FrameDesc *frames ) const;
+
+	private:
+		int  head, tail, count;
+		int *prev, *next;
+};
+
+// A bounded list of page numbers, oldest first: the "ghost" entries of
+// pages recently evicted.  Adding to a full list drops the oldest.  The
+// entries are linked both ways and hashed on their page number, so that
+// removing one costs no more than a look along its hash chain.
+class PageList {
+
+	public:
+		PageList() : node(0), bucket(0), nbuckets(0), oldest(-1),
+			newest(-1), unused(-1), count(0), cap(0) {}
+		~PageList() { delete [] node; delete [] bucket; }
+
+		void init( int capacity );
+
+		void push( int pageNo );
+		bool remove( int pageNo );
+		void pop_oldest();
+		int  size() const { return count; }
+
+	private:
+		struct Node {
+			int pageNo;
+			int prev, next;     // towards the oldest and the newest
+			int chain;          // the next in its bucket, or unused
+		};
+
+		Node *node;             // [cap]
+		int  *bucket;           // [nbuckets] newest node of each chain
+		int   nbuckets;
+		int   oldest, newest;
+		int   unused;           // nodes not on the list
+		int   count, cap;
+
+		int *chainOf( int pageNo )
+		{ return &bucket[(unsigned) pageNo % nbuckets]; }
+		void unlink( int n );
+};
+
+// *****************************************************
+// LRU-K: evicts the page whose K-th most recent reference is the
+// oldest; pages seen fewer than K times go first, least recently used
+// first.  Pins of a page that is already pinned count as one
+// (correlated) reference.  The history of evicted pages is kept in a
+// small table so that a page coming back is not treated as new.  The
+// frames with a page are kept in a heap in the order they go in, which
+// a reference only ever moves a frame down.
+class LRUK : public PageReplacer {
+
+	public:
+		LRUK( int k = 2 );
+		~LRUK();
+
+		const char *name() { return "LRU-K"; }
+
+	protected:
+		void setup( int numFrames );
+		int  victim();
+		void admit( int frameNo, int pageNo );
+		void touch( int frameNo );
+		void drop( int frameNo );
+
+	private:
+		int            K;
+		unsigned long  now;
+		unsigned long *hist;    // [numBuffers][K], most recent first
+		int            noldpages;
+		int           *oldpage; // [noldpages], hashed on the page number
+		unsigned long *oldhist; // [noldpages][K]
+
+		int           *heap;    // [numBuffers] frames, next victim first
+		int           *heapPos; // [numBuffers] where in heap, or -1
+		int            nheap;
+		int           *skipped; // [numBuffers] pinned, for victim
+
+		void reference( unsigned long *h, bool correlated );
+		bool before( int f, int g );
+		void heapSet( int i, int frameNo );
+		void heapUp( int i );
+		void heapDown( int i );
+		void heapAdd( int frameNo );
+		void heapRemove( int frameNo );
+};
+
+// *****************************************************
+// 2Q (Johnson & Shasha): pages enter a FIFO queue A1in; only pages
+// referenced again after leaving it, while still remembered in the
+// ghost queue A1out, make it into the LRU queue Am.  A large scan thus
+// washes through A1in without disturbing Am.
+class TwoQ : public PageReplacer {
+
+	public:
+		TwoQ();
+		~TwoQ();
+
+		const char *name() { return "2Q"; }
+
+	protected:
+		void setup( int numFrames );
+		int  victim();
+		void admit( int frameNo, int pageNo );
+		void touch( int frameNo );
+		void drop( int frameNo );
+
+	private:
+		enum Queue { None, A1in, Am };
+
+		int        kin;         // target size of A1in
+		FrameList  a1in, am;
+		PageList   a1out;
+		Queue     *queue;       // [numBuffers]
+		int       *links;       // [2*numBuffers]
+};
+
+// *****************************************************
+// ARC (Megiddo & Modha): recency list T1 and frequency list T2 with
+// ghost lists B1 and B2; hits on the ghosts move the split between T1
+// and T2 towards whichever would have kept the page.
+class ARC : public PageReplacer {
+
+	public:
+		ARC();
+		~ARC();
+
+		const char *name() { return "ARC"; }
+
+	protected:
+		void setup( int numFrames );
+		int  victim();
+		void admit( int frameNo, int pageNo );
+		void touch( int frameNo );
+		void drop( int frameNo );
+
+	private:
+		enum List { None, T1, T2 };
+
+		int        c;           // cache size
+		int        p;           // target size of T1
+		FrameList  t1, t2;
+		PageList   b1, b2;
+		List      *list;        // [numBuffers]
+		int       *links;       // [2*numBuffers]
+};
+
 // *****************************************************
 
 #endif // _BUF_H
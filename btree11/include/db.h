@@ -3,7 +3,10 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "page.h"
+#include "io_queue.h"
 
 
 // Each database is basically a UNIX file and consists of several relations
@@ -20,12 +23,18 @@ class DB
 {
 	public:
 		// Constructors
-		// Create a database with the specified number of pages where the page
-		// size is the default page size.
-		DB( const char* name, unsigned num_pages, Status& status );
-
-		// Open the database with the given name.
-		DB( const char* name, Status& status );
+		// Create a database with the specified number of pages of
+		// page_size bytes, a power of two from MINIBASE_DEFAULT_PAGESIZE
+		// to MINIBASE_MAX_PAGESIZE.  If mapped, the file is mapped
+		// into memory and the buffer manager uses the mapping for its
+		// pages (see map_file).
+		DB( const char* name, unsigned num_pages, Status& status,
+				bool mapped = false,
+				int page_size = MINIBASE_DEFAULT_PAGESIZE );
+
+		// Open the database with the given name.  Its page size is the
+		// one it was created with.
+		DB( const char* name, Status& status, bool mapped = false );
 
 		// Destructor : closes the database
 		~DB();
@@ -44,11 +53,21 @@ class DB
 		// Gives back the page number of the first page of the allocated run.
 		Status allocate_page(PageId& start_page_num, int run_size = 1);
 
+		// Allocate a run of run_size pages if there is one, else of half
+		// as many, and so on down to 1.  run_size comes back as the
+		// length of the run.
+		Status allocate_run(PageId& start_page_num, int& run_size);
+
 		// Deallocate a set of pages starting at the specified page number and
 		// a run size can be specified.
 		Status deallocate_page(PageId start_page_num, int run_size = 1);
 
 
+		// The directory of files is also kept in memory, hashed by name
+		// (the catalog), from the first time one of these is called:
+		// looking up a file, or adding or deleting one, then reads no
+		// more than the one directory page it changes.
+
 		// Adds a file entry to the header page(s).
 		Status add_file_entry(const char* fname, PageId start_page_num);
 
@@ -66,9 +85,43 @@ class DB
 		// Write the contents of the specified page.
 		Status write_page(PageId pageno, Page* pageptr);
 
+		// Write a run of pages, from run_size places in memory, with one
+		// system call.
+		Status write_pages(PageId start_page_num, int run_size,
+				Page** pageptrs);
+
+		// Ask the OS to start reading a run of pages in the background, so
+		// that a read_page of any of them soon after does not wait for
+		// the disk.  Pages past the end of the database are ignored.
+		Status prefetch_pages(PageId start_page_num, int run_size = 1);
+
+		// The whole file mapped into memory, page by page, or NULL.
+		Page* mapping() const { return (Page*) map; }
+
+		// Write the changed pages of a run in the mapping to disk.
+		Status sync_pages(PageId start_page_num, int run_size = 1);
+
+		// Start reading or writing n pages without waiting for them (see
+		// io_queue.h): each request completes later in an I/O thread,
+		// which calls its done function.  Nothing is started if a page
+		// number is bad.
+		Status submit_io(IORequest **reqs, int n);
+
+		// Read or write n pages, all at once, and wait for them.
+		Status run_io(IORequest **reqs, int n);
+
+		// Wait for all the reads and writes submitted so far.
+		void wait_io();
+
 		// Print out the space map of the database.
 		Status dump_space_map();
 
+		// The log put an image of page pageno back.  If it is a page
+		// of the space map, it is read again; if it is a directory
+		// page, the catalog is dropped, to be read again when next
+		// needed.  Any other page is ignored.
+		Status restored_page( PageId pageno );
+
 		enum {
 			DB_FULL,
 			DUPLICATE_ENTRY,
@@ -77,13 +130,55 @@ class DB
 			FILE_IO_ERROR,
 			FILE_NOT_FOUND,
 			FILE_NAME_TOO_LONG,
-			NEG_RUN_SIZE
+			NEG_RUN_SIZE,
+			IO_THREAD_ERROR,
+			BAD_PAGE_SIZE,
+			BAD_FORMAT
 		};
 
 	private:
 		int fd;
 		unsigned num_pages;
 		char* name;
+		pthread_mutex_t lock;   // space map and directory
+		IOQueue *ioq;           // asynchronous reads and writes
+		char *map;              // [num_pages] pages, if mapped
+
+		// The space map, kept in memory as well, a word of 64 pages at
+		// a time (see allocate_page): the bytes of the map pages, read
+		// as little-endian words.  The bits past the last page are
+		// set.
+		uint64_t *space;        // [num_map_pages * words_per_map_page()]
+		unsigned *map_free;     // [num_map_pages] free pages by map page
+		unsigned num_map_pages;
+		unsigned num_free;
+		unsigned first_free;    // no page is free in a word before it
+
+		// The catalog: a hash table of the directory's entries, with
+		// linear probing, and the directory pages in chain order.
+		struct catalog_entry
+		{
+			PageId   pagenum;       // INVALID_PAGE if unused.
+			unsigned dir;           // Where the entry is: dir_pages[dir],
+			unsigned slot;          // entries[slot].
+			char     fname[MAX_NAME];
+		};
+
+		catalog_entry *catalog;     // [catalog_size]; NULL if not read
+		unsigned catalog_size;      // a power of two
+		unsigned catalog_used;
+		PageId  *dir_pages;         // [max_dir_pages]
+		unsigned num_dir_pages;
+		unsigned max_dir_pages;
+		unsigned first_open_dir;    // no free entry on a page before it
+
+		// Map the file (num_pages pages) and hand the mapping to the
+		// buffer manager.
+		Status map_file();
+
+		// Give the page size to the buffer manager, and to everyone
+		// else (MINIBASE_PAGESIZE).
+		Status use_page_size( int page_size );
 
 
 		struct file_entry
@@ -100,9 +195,13 @@ class DB
 		};
 
 		// A first_page structure appears on the first page of the database.
+		// A file whose magic and format do not match is not opened.
 		struct first_page
 		{
+			unsigned magic;         // DB_MAGIC
+			unsigned format;        // DB_FORMAT
 			unsigned num_db_pages;  // How big the database is.
+			unsigned page_size;     // In bytes (MINIBASE_PAGESIZE).
 			directory_page dir;     // The first page's directory starts here.
 		};
 
@@ -115,7 +214,7 @@ class DB
 
 		   The first page of the database (page ID 0) is reserved for a special
 		   structure that holds global information about the database, like the
-		   number of pages in the database.  After this special first-page
+		   format it is in, the number of pages in the database and their size.  After this special first-page
 		   information comes the first (of possibly many) "directory page."  A
 		   directory page is where the DB keeps track of the files created within
 		   the database.
@@ -127,9 +226,37 @@ class DB
 */
 
 
+		// Find the first run of runsize free pages in the copy.
+		bool find_run( unsigned runsize, unsigned& start );
+
 		// Set runsize bits starting from start to value specified
 		Status set_bits( PageId start, unsigned runsize, int bit );
 
+		// Build the space map's copy in memory, and copy one page of
+		// it (map page i, page 1+i of the database) again.
+		Status load_space_map();
+		Status load_map_page( unsigned i );
+
+		// The same bits in the copy; the counts follow.
+		void set_space_bits( PageId start, unsigned runsize, int bit );
+		void find_first_free();
+
+		// Read the directory into the catalog, or forget it.
+		Status load_catalog();
+		void drop_catalog();
+
+		// The catalog's entry for fname, or -1; add one, remove one.
+		int  find_entry( const char* fname );
+		void insert_entry( const char* fname, PageId pagenum,
+				unsigned dir, unsigned slot );
+		void remove_entry( int e );
+
+		// Add a page to the end of dir_pages.
+		void add_dir_page( PageId pageno );
+
+		// The directory in directory page hpid, pinned at pg.
+		directory_page* dir_of( PageId hpid, char* pg );
+
 		// Initializes the given directory page.
 		void init_dir_page( directory_page* dp, unsigned used_bytes );
 
@@ -6,7 +6,7 @@
 #include "page.h"
 
 const int INVALID_SLOT =  -1;
-const int EMPTY_SLOT   =  -1;
+const int EMPTY_SLOT   =  0xffff;
 
 // Class definition for a minibase data page.   
 // The design assumes that records are kept compacted when
@@ -14,13 +14,18 @@ const int EMPTY_SLOT   =  -1;
 // array cannot be compacted.  Notice, this class does not keep
 // the records aligned, relying instead on upper levels to take
 // care of non-aligned attributes.
+//
+// A page is MINIBASE_PAGESIZE bytes, which the database decides (see
+// DB::DB), so the slot array is found from the end of the page rather
+// than declared: slot_dir()[-i] is slot i.  Offsets and lengths are
+// unsigned, which is what lets them span a 64 KB page.
 
 class HFPage {
 
 	protected:
 		struct slot_t {
-			short offset;  
-			short length;    // equals EMPTY_SLOT if slot is not in use
+			unsigned short offset;
+			unsigned short length;    // equals EMPTY_SLOT if slot is not in use
 		};
 
 
@@ -36,9 +41,9 @@ class HFPage {
     
 
     
-		short     slotCnt;     // number of slots in use
-		short     freePtr;     // offset of first used byte in data[]
-		short     freeSpace;   // number of bytes free in data[]
+		short          slotCnt;     // number of slots in use
+		unsigned short freePtr;     // offset of first used byte in data[]
+		unsigned short freeSpace;   // number of bytes free in data[]
 
 		short     type;        // an arbitrary value used by subclasses as needed
 
@@ -46,10 +51,15 @@ class HFPage {
 		PageId    nextPage;    // forward pointer to data page
 		PageId    curPage;     // page number of this page
 
-		char      data[MAX_SPACE - DPFIXED]; 
+		char      data[MAX_SPACE - DPFIXED];   // sized for the largest page
 
 
-		slot_t    slot[1];     // first element of slot array.
+		// first element of slot array, in the last bytes of the page
+		slot_t   *slot_dir()
+		{ return (slot_t *)((char *)this + MINIBASE_PAGESIZE) - 1; }
+
+		// size of data[] on this database's pages (up to slot 0)
+		static int data_space() { return MINIBASE_PAGESIZE - DPFIXED; }
     
     
     
@@ -40,4 +40,20 @@ class IndexFileScan {
 };
 
 
+// A stream of <key, rid> pairs in no particular order, e.g. the keys
+// extracted from a scan of a data file.  get_next returns DONE once the
+// stream is exhausted.
+class KeySource {
+	public:
+		virtual ~KeySource() {}
+
+		virtual Status get_next(RID &rid, void* keyptr) = 0;
+};
+
+// A KeySource that delivers its pairs in ascending key order; this is
+// what an index is built from bottom-up (see BTreeFile::bulkLoad).
+class SortedKeySource : public KeySource {
+};
+
+
 #endif
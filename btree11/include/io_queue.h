@@ -0,0 +1,175 @@
+/* -*- C++ -*- */
+/*
+ * io_queue.h - definition of class IOQueue and its two kinds
+ */
+
+#ifndef _IO_QUEUE_H
+#define _IO_QUEUE_H
+
+#include <pthread.h>
+
+#include "minirel.h"
+#include "page.h"
+
+/*
+ * One page to read or write through an IOQueue.  The queue fills in
+ * status and then calls done(req) from a thread of its own; done may
+ * submit more requests.  Until then the request and its page belong to
+ * the queue.
+ */
+
+struct IORequest {
+	enum Op { READ, WRITE };
+
+	Op         op;
+	PageId     pageNo;
+	Page      *page;
+	Status     status;              // OK, or FAIL if not all of the
+	                                // page was read or written
+	void     (*done)(IORequest *);  // may be NULL
+	void      *arg;                 // for done
+
+	IORequest *next;                // used by the queue
+};
+
+/*
+ * An IOQueue reads and writes pages of a file without making the caller
+ * wait: submit hands it a batch of requests and returns, and each
+ * request completes later, in one of the queue's threads.  run is the
+ * same, but waits for the batch.
+ *
+ * IOQueue::create picks the kind: a URingQueue, which hands each batch
+ * to the kernel's io_uring in one system call and has one thread
+ * reaping the completions, or, where io_uring is not to be had, a
+ * ThreadPoolQueue, whose threads take the requests one by one with
+ * pread and pwrite.  Building with NO_IO_URING leaves io_uring out.
+ *
+ * The queue does not post errors: a failed request just has status
+ * FAIL, and whoever looks at it says what went wrong.
+ */
+
+class IOQueue {
+
+	public:
+		// a queue for file descriptor fd; NULL if no kind could be set
+		// up, with the error posted
+		static IOQueue *create(int fd, Status& status);
+
+		// waits for the outstanding requests
+		virtual ~IOQueue();
+
+		// start the n requests
+		void   submit(IORequest **reqs, int n);
+
+		// start the n requests and wait for them; their done and arg
+		// are taken over.  FAIL if any of them failed.
+		Status run(IORequest **reqs, int n);
+
+		// wait until every request submitted so far has completed,
+		// along with any its done submitted
+		void   drain();
+
+		virtual const char *name() = 0;
+
+	protected:
+		IOQueue(int fd);
+
+		int fd;
+
+		// hand the requests to the I/O; called without the lock
+		virtual void start(IORequest **reqs, int n) = 0;
+
+		// the I/O of req is over: call its done
+		void   complete(IORequest *req);
+
+		// read or write req's page with pread or pwrite
+		void   transfer(IORequest *req);
+
+	private:
+		pthread_mutex_t lock;
+		pthread_cond_t  idle;         // outstanding dropped to 0
+		int             outstanding;  // submitted, done not yet back
+};
+
+/*
+ * io_uring.  Submissions go into the submission ring under a lock and
+ * are handed to the kernel together; at most as many as the completion
+ * ring holds are in flight, and the rest wait on a list of our own
+ * until the reaper makes room.  The reaper thread sleeps in the kernel
+ * until completions come in.  Requests the kernel will not take are
+ * done with pread and pwrite.
+ */
+
+class URingQueue : public IOQueue {
+
+	public:
+		// status is FAIL (nothing posted) if the kernel will not give us
+		// a ring
+		URingQueue(int fd, Status& status);
+		~URingQueue();
+
+		const char *name() { return "io_uring"; }
+
+	protected:
+		void start(IORequest **reqs, int n);
+
+	private:
+		enum { RING_ENTRIES = 64 };
+
+		int        ringfd;
+		void      *sqmem, *cqmem, *sqemem;   // the mapped rings
+		size_t     sqsize, cqsize, sqesize;
+
+		unsigned  *sqHead, *sqTail, *sqMask, *sqArray;
+		unsigned   sqEntries;
+		struct io_uring_sqe *sqes;
+		unsigned  *cqHead, *cqTail, *cqMask;
+		struct io_uring_cqe *cqes;
+		unsigned   cqEntries;
+
+		pthread_mutex_t sqLock;    // the submission ring and what follows
+		IORequest *waitHead;       // not in the ring yet, oldest first
+		IORequest *waitTail;
+		unsigned   inFlight;       // in the ring or with the kernel
+		bool       stopping;
+
+		pthread_t  reaper;
+		bool       started;
+
+		static void *reap(void *arg);
+		IORequest *fill();
+		void   fallback(IORequest *reqs);
+		bool   enter(unsigned toSubmit, unsigned minComplete);
+};
+
+/*
+ * pread and pwrite in a few threads of our own.
+ */
+
+class ThreadPoolQueue : public IOQueue {
+
+	public:
+		ThreadPoolQueue(int fd, Status& status);
+		~ThreadPoolQueue();
+
+		const char *name() { return "thread pool"; }
+
+	protected:
+		void start(IORequest **reqs, int n);
+
+	private:
+		enum { POOL_THREADS = 4 };
+
+		pthread_mutex_t poolLock;
+		pthread_cond_t  work;      // a request was queued, or stopping
+		IORequest *head;           // waiting requests, oldest first
+		IORequest *tail;
+		bool       stopping;
+
+		pthread_t  threads[POOL_THREADS];
+		int        nthreads;
+
+		static void *serve(void *arg);
+};
+
+#endif  // _IO_QUEUE_H
@@ -34,7 +34,15 @@ typedef struct RID{
 } RID;
 
 
-const int MINIBASE_PAGESIZE = 1024;           // in bytes
+const int MINIBASE_DEFAULT_PAGESIZE = 1024;   // in bytes
+const int MINIBASE_MAX_PAGESIZE = 65536;
+
+// The page size of the database, a power of two between the two above:
+// it is chosen when the database is created, and kept in its first page
+// (see DB::DB).
+extern int minibase_pagesize;
+#define MINIBASE_PAGESIZE minibase_pagesize
+
 const int MINIBASE_BUFFER_POOL_SIZE = 1024;   // in Frames
 const int MINIBASE_DB_SIZE = 10000;           /* in Pages => the DBMS Manager
                                                  tells the DB how much disk
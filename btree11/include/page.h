@@ -10,9 +10,11 @@
 
 const PageId INVALID_PAGE = -1;
 
-const int MAX_SPACE = MINIBASE_PAGESIZE;
+const int MAX_SPACE = MINIBASE_MAX_PAGESIZE;
 
 
+// A page is MINIBASE_PAGESIZE bytes.  The class has room for the largest
+// page; the buffer pool's frames are only as big as the database's.
 class Page {
 
 	public:
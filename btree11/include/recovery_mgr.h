@@ -0,0 +1,194 @@
+/* -*- C++ -*- */
+/*
+ * recovery_mgr.h - definition of class RecoveryMgr, the write-ahead log
+ */
+
+#ifndef _RECOVERY_MGR_H
+#define _RECOVERY_MGR_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "minirel.h"
+#include "page.h"
+
+/*
+ * The log of changes to the pages of the database, for redo and undo.
+ *
+ * A record of the log says which bytes of a page changed, and to what
+ * (an update), how to take back an entry a transaction put into or took
+ * out of an index (an undo record), or that a transaction began,
+ * committed or aborted.  Applying an update twice does no harm, so
+ * recovery needs no page LSNs: it redoes every update in the log, in
+ * order, and then carries out, newest first, the undo records of the
+ * transactions that neither committed nor aborted.  An LSN is where a
+ * record starts in the log, counting from the creation of the log file;
+ * records are appended to a buffer, and a log writer thread of our own
+ * writes the buffer out and syncs it.  Everyone who wants the log on
+ * disk up to some LSN in the meantime waits for the next round, so the
+ * commits that come in during one sync all go out with the next one
+ * (group commit).
+ *
+ * Transactions belong to threads: begin_transaction starts one for
+ * the calling thread, and the changes the thread makes until it
+ * commits or aborts are the transaction's.  Updates are redone, never
+ * undone: a page may hold the changes of several transactions at once,
+ * and its entries move between pages as it splits and merges, so
+ * putting back its old bytes would take back the others' changes as
+ * well.  Undo goes through the B+ tree instead (see BTreeFile::undo),
+ * which deletes the entries the transaction inserted and inserts the
+ * ones it deleted, wherever they are by then; splits and merges stay.
+ * Creating, destroying and bulk loading a file are not undone.  There
+ * is no locking of entries: a transaction sees the entries of others
+ * that have not committed yet.  Changes outside a transaction are not
+ * logged, except to pages with updates in the log already, whose
+ * changes all have to be there for redo to come out right.
+ *
+ * The buffer manager finds the updates (see BufMgr::logChanges): it
+ * keeps a copy of each page as last logged, and logs the difference
+ * when the page is unpinned.  The first update of a page in the log
+ * covers the whole page, so that redo does not depend on what was on
+ * disk (which may also be a torn write).  Before a page is written,
+ * the log is synced up to its last update.
+ *
+ * The log is cut back to nothing (a checkpoint) when no transaction is
+ * running and it has grown past its maximum size, after every page has
+ * been written out, and when the system shuts down.
+ */
+
+class RecoveryMgr {
+
+	public:
+		// Open the log named logname, maxsize pages long at most
+		// (roughly), and bring the database back to what its
+		// committed transactions left, unless fresh: then the log is
+		// for a new database, and anything in it is thrown away.
+		RecoveryMgr(const char *logname, unsigned maxsize, bool fresh,
+				Status& status);
+
+		// A checkpoint, unless transactions are still running; their
+		// changes are in the log, for recovery to undo.
+		~RecoveryMgr();
+
+		Status begin_transaction();
+		// waits for the commit record to be on disk
+		Status commit_transaction();
+		// takes back the transaction's inserts and deletes
+		Status abort_transaction();
+		// the calling thread's transaction, or 0
+		int    current_transaction();
+
+		// For callers that know what they changed: log the change
+		// of length bytes at offset of page pageNum to new_image
+		// (old_image is not needed), made by the calling thread.  For a page pinned
+		// in the buffer pool (page_ptr), the buffer manager's copy of
+		// the page already holds the old image, and the change goes
+		// into the log along with any the caller did not describe.
+		Status WriteUpdateLog(unsigned length, PageId pageNum, int offset,
+				char *old_image, char *new_image, Page *page_ptr);
+
+		// Used by the buffer manager.  logged: whether changes to
+		// pageNo now go into the log; track: note that they do from
+		// now on, true if they did not before (log the whole page);
+		// log_update: append an update, lsn is where it ends.
+		bool   logged(PageId pageNo);
+		bool   track(PageId pageNo);
+		Status log_update(PageId pageNo, int offset, int length,
+				const char *after, uint64_t &lsn);
+
+		// Used by the B+ tree: what takes back an insert or delete of
+		// the calling thread's transaction, length bytes handed back to
+		// BTreeFile::undo on abort.  Nothing is logged outside of a
+		// transaction, or while undoing one.
+		Status log_undo(const char *body, int length);
+
+		// Wait until the log is on disk up to lsn.
+		Status flush(uint64_t lsn);
+
+		// Write out every page and cut the log back, if no transaction
+		// is running.
+		Status checkpoint();
+
+		enum {
+			LOG_OPEN_ERROR,
+			LOG_IO_ERROR,
+			LOG_THREAD_ERROR,
+			IN_TRANSACTION,
+			NO_TRANSACTION,
+			RECOVERY_FAILED
+		};
+
+	private:
+		enum { BEGIN = 1, UPDATE, COMMIT, ABORT, UNDO };
+
+		static const uint64_t NO_LSN = ~(uint64_t) 0;
+
+		// A record: this header, then length bytes of the after image
+		// (updates) or of what BTreeFile::undo is given (undo
+		// records), padded to 8 bytes.
+		struct LogRecord {
+			uint64_t lsn;       // where it starts
+			uint64_t prevLsn;   // the transaction's previous undo record
+			uint32_t size;      // all of it
+			uint32_t check;     // CRC of what follows it, then of it
+			                    // with check 0
+			uint32_t txn;       // 0 outside of a transaction
+			int32_t  pageNo;
+			uint32_t type;
+			uint32_t offset;
+			uint32_t length;
+			uint32_t pad;
+		};
+
+		// The first bytes of the file; the record with LSN base is
+		// at HEADER_SIZE.
+		struct LogHeader {
+			uint32_t magic;
+			uint32_t check;
+			uint64_t base;
+		};
+
+		enum { HEADER_SIZE = 512, LOG_MAGIC = 0x4d624c67 };
+
+		int         fd;
+		uint64_t    maxBytes;
+
+		// the tail of the log not yet written, and the one being written
+		pthread_mutex_t logLock;   // all that follows
+		pthread_cond_t  work;      // wanted went up, or stopping
+		pthread_cond_t  flushed;   // durable went up, or the log failed
+		char       *buf;
+		unsigned    bufLen, bufCap;
+		char       *wbuf;          // the log writer's
+		unsigned    wbufCap;
+		uint64_t    base;          // LSN of the file's first record
+		uint64_t    bufStart;      // LSN of buf[0]
+		uint64_t    durable;       // on disk up to here
+		uint64_t    wanted;        // someone waits for this much
+		bool        writing;       // the log writer is at the disk
+		bool        failed;        // a write or sync failed
+		bool        stopping;
+		uint32_t    nextTxn;
+		int         active;        // transactions running
+		bool        checkpointing; // no new transactions meanwhile
+		pthread_cond_t  idle;      // a transaction ended, or the
+		                           // checkpoint did
+
+		// the pages with updates in the log: open addressing
+		int        *tracked;       // [trackCap], INVALID_PAGE if free
+		unsigned    ntracked, trackCap;
+
+		pthread_t   writer;
+		bool        started;
+
+		static void *write_log(void *arg);
+		Status append(LogRecord &rec, const char *body, uint64_t &end);
+		Status read_record(uint64_t lsn, LogRecord &rec, char *body);
+		Status recover();
+		Status apply(PageId pageNo, int offset, int length, const char *image);
+		Status truncate();
+		void   forget_pages();
+		bool   find_page(PageId pageNo, unsigned &slot);
+};
+
+#endif  // _RECOVERY_MGR_H
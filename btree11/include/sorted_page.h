@@ -14,6 +14,8 @@
  */
 
 
+#include <string.h>
+
 #include "minirel.h"
 #include "page.h"
 #include "hfpage.h"
@@ -34,6 +36,7 @@ class SortedPage : public HFPage {
 			_OK = 0,   /* these are indices */
 			INSERT_REC_FAILED,
 			DELETE_REC_FAILED,
+			SET_HIGH_KEY_FAILED,
 			NR_ERRORS              /* and this is the number of them */
 		};
 
@@ -74,8 +77,80 @@ class SortedPage : public HFPage {
 
 		int   free_space() { return available_space();}
 
+		// The NodeType lives in the low bits of `type'; the PACKED_KEYS bit
+		// marks a page of fixed-width integer entries that are kept
+		// physically in key order at the start of data[], so that the keys
+		// can be searched with vector compares (see packed_rank).
+		// The PREFIX_KEYS bit marks a front-coded string leaf (see
+		// BTLeafPage::set_prefixed), HIGH_KEY a page with a high key
+		// (see set_high_key), and DEAD a node that was merged into its
+		// left sibling and is no longer in the tree (see
+		// BTreeFile::freeNode).
+		// set_type clears all four bits; set them again with set_packed,
+		// set_prefixed, set_high_key or set_dead.
+		enum { PACKED_KEYS = 0x100, PREFIX_KEYS = 0x200, HIGH_KEY = 0x400,
+			DEAD = 0x800 };
+
 		void     set_type(NodeType t) { type = (short)t; }
-		NodeType get_type()           { return (NodeType)type; }
+		NodeType get_type()
+		{ return (NodeType)(type & ~(PACKED_KEYS | PREFIX_KEYS | HIGH_KEY | DEAD)); }
+
+		void     set_packed(bool on)
+		{ type = (short)(on ? (type | PACKED_KEYS) : (type & ~PACKED_KEYS)); }
+		bool     packed()             { return (type & PACKED_KEYS) != 0; }
+		bool     prefixed()           { return (type & PREFIX_KEYS) != 0; }
+		void     set_dead()           { type = (short)(type | DEAD); }
+		bool     dead()               { return (type & DEAD) != 0; }
+
+		// Make this page a copy of page, but for its own page number
+		// (see BTreeFile::moveNode).
+		void     copy_from(SortedPage *page);
+
+		// Number of entries on a PACKED_KEYS page whose key is <= key
+		// (< key if strict), i.e. the slot number a search for key ends
+		// up at.  Uses AVX2 or SSE2 compare-and-movemask when the CPU
+		// has them and vector_rank is set (the default), a binary search
+		// otherwise.
+		int   packed_rank(int key, bool strict);
+		// The same for n entries of stride bytes at base.
+		static int packed_rank(const char *base, int stride, int n,
+				int key, bool strict);
+		static bool vector_rank;
+
+		// The high key bounds the keys that belong on the page from
+		// above; a page without one (the rightmost of its level) has no
+		// bound.  It is stored as a length byte and the key at the start
+		// of data[], ahead of the records, which are moved up or down to
+		// make room.  set_high_key(NULL, ...) removes it; it fails if
+		// the page has no room for the key.
+		Status set_high_key(const void *key, AttrType key_type);
+		bool   get_high_key(void *key);   // false if there is none
+
+		// Is key beyond the high key, so that it belongs on a page to
+		// the right?  A key equal to the high key is beyond it unless
+		// run is set: a run of duplicates may start on the page whose
+		// high key it equals (see BTreeFile::findRunStart).  Looks at
+		// no more than the page, even while it is being changed.
+		bool   past_high_key(const void *key, AttrType key_type, bool run);
+
+	protected:
+		// Offset in data[] of the record area: just past the high key.
+		int   records_start()
+		{ return (type & HIGH_KEY) ? 1 + (unsigned char) data[0] : 0; }
+
+		// Offset in data[] of the first entry: past the prefix too, on a
+		// front-coded leaf.
+		int   entries_start()
+		{
+			int start = records_start();
+			return prefixed() ? start + strlen(data + start) + 1 : start;
+		}
+
+		// Moves the one record that is out of place on a PACKED_KEYS or
+		// PREFIX_KEYS page (the one just inserted, say) in among the
+		// others, so that the records lie back to back in slot order
+		// again.
+		void  pack_slot(int slotNo);
 };
 
 #endif
@@ -13,7 +13,9 @@
 
 
 class BufMgr;
+class Replacer;
 class DB;
+class RecoveryMgr;
 //class Catalog;
 
 #define MINIBASE_MAXARRSIZE 50
@@ -23,16 +25,20 @@ class SystemDefs
 
 public:
 	SystemDefs( Status& status, const char* dbname, unsigned dbpages =0,
-			unsigned bufpoolsize =0, const char* replacement_policy =0 );
+			unsigned bufpoolsize =0, const char* replacement_policy =0,
+			unsigned pagesize =0 );
 	/* This constructor uses a default log name and size, for multi-user
 	   Minibase.  For single-user Minibase, this is the designated
 	   constructor.  If "dbpages" is 0, the database is opened; if it is
-	   greater than 0, the database is created with that number of pages. */
+	   greater than 0, the database is created with that number of pages,
+	   of "pagesize" bytes (0 for MINIBASE_DEFAULT_PAGESIZE).  An opened
+	   database has the page size it was created with. */
 
 
 	SystemDefs( Status& status, const char* dbname, const char* logname,
 			unsigned dbpages, unsigned maxlogsize,
-			unsigned bufpoolsize =0, const char* replacement_policy =0 );
+			unsigned bufpoolsize =0, const char* replacement_policy =0,
+			unsigned pagesize =0 );
 	/* This constructor lets you specify all aspects of the system. */
 
 
@@ -60,16 +66,33 @@ public:
 	char* GlobalDBName;
 	char* GlobalLogName;
 
+	/* The write-ahead log, and the transactions (see recovery_mgr.h).
+	   Opening a database recovers it from its log.  The log is at most
+	   about maxlogsize pages long, between checkpoints.  NULL in mmap
+	   mode, which has no frames to keep copies of. */
+	RecoveryMgr* GlobalRecoveryMgr;
+
+	/* The buffer pool's replacement policy, named by the
+	   replacement_policy argument: "Clock" (the default), "LRU-K" (K = 2,
+	   or "LRU-3" etc.), "2Q" or "ARC".  Its info() prints the buffer
+	   pool hit ratio.  Owned by the buffer manager.  "mmap" instead maps
+	   the database file into memory and leaves the replacing to the OS
+	   (see buf_map.C); for databases that fit in memory. */
+	Replacer* GlobalReplacer;
+
 protected:
 	void init( Status& status, const char* dbname, const char* logname,
 			unsigned dbpages, unsigned maxlogsize,
-			unsigned bufpoolsize, const char* replacement_policy );
+			unsigned bufpoolsize, const char* replacement_policy,
+			unsigned pagesize );
 };
 
 extern SystemDefs* minibase_globals;
 
 #define  MINIBASE_DB                    (minibase_globals->GlobalDB)
 #define  MINIBASE_BM                    (minibase_globals->GlobalBufMgr)
+#define  MINIBASE_REPLACER              (minibase_globals->GlobalReplacer)
+#define  MINIBASE_RECMGR                (minibase_globals->GlobalRecoveryMgr)
 
 
 #define  MINIBASE_DBNAME                (minibase_globals->GlobalDBName)